@@ -0,0 +1,351 @@
+#include "conversionserver.h"
+#include "fontconverter.h"
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QJsonValue>
+#include <QTextStream>
+#include <QDir>
+#include <QPoint>
+#include <QSize>
+#include <QRegularExpression>
+#include <QDebug>
+#include <stdio.h>
+#include <limits.h>
+
+
+ConversionServer::ConversionServer(QObject *parent) : QObject(parent)
+{
+    server = new QLocalServer(this);
+    font_converter = new FontConverter(this);
+    font_converter->setFontCaching(true);
+
+    connect(server, &QLocalServer::newConnection, this, &ConversionServer::newConnection);
+}
+
+ConversionServer::~ConversionServer()
+{
+    delete font_converter;
+    delete server;
+}
+
+bool ConversionServer::listen(const QString& name)
+{
+    // Работающий сервер не заменяется.
+    QLocalSocket probe;
+    probe.connectToServer(name);
+
+    if(probe.waitForConnected(1000)){
+        probe.disconnectFromServer();
+        qDebug() << tr("Server is already running: %1").arg(name);
+        return false;
+    }
+
+    // Сокет, оставшийся от завершившегося сервера.
+    QLocalServer::removeServer(name);
+
+    // Задания записывают файлы, принимаются только от владельца.
+    server->setSocketOptions(QLocalServer::UserAccessOption);
+
+    if(!server->listen(name)){
+        qDebug() << tr("Error listening socket: %1").arg(server->errorString());
+        return false;
+    }
+
+    qDebug() << tr("Listening: %1").arg(server->fullServerName());
+
+    return true;
+}
+
+int ConversionServer::runStdio()
+{
+    QTextStream in(stdin);
+    QTextStream out(stdout);
+
+    while(!in.atEnd()){
+        QString line = in.readLine();
+
+        if(line.trimmed().isEmpty()) continue;
+
+        out << processJob(line.toUtf8()) << "\n";
+        out.flush();
+    }
+
+    return 0;
+}
+
+int ConversionServer::runClient(const QString& name, const QByteArray& job)
+{
+    QJsonParseError parse_error;
+    QJsonDocument doc = QJsonDocument::fromJson(job, &parse_error);
+
+    if(!doc.isObject()){
+        qDebug() << tr("Error parsing job: %1").arg(parse_error.errorString());
+        return 1;
+    }
+
+    // Относительные пути разрешаются относительно каталога клиента.
+    QJsonObject job_obj = doc.object();
+    if(!job_obj.contains("dir")){
+        job_obj.insert("dir", QDir::currentPath());
+    }
+
+    QLocalSocket socket;
+    socket.connectToServer(name);
+
+    if(!socket.waitForConnected(1000)){
+        qDebug() << tr("Server is not available, converting locally");
+
+        FontConverter converter;
+        QString error;
+
+        if(!runJob(&converter, job_obj, &error)){
+            qDebug() << error;
+            return 1;
+        }
+        return 0;
+    }
+
+    socket.write(QJsonDocument(job_obj).toJson(QJsonDocument::Compact));
+    socket.write("\n");
+
+    while(!socket.canReadLine()){
+        if(!socket.waitForReadyRead(-1)){
+            qDebug() << tr("Error reading response: %1").arg(socket.errorString());
+            return 1;
+        }
+    }
+
+    QJsonObject response = QJsonDocument::fromJson(socket.readLine()).object();
+
+    socket.disconnectFromServer();
+
+    if(!response.value("ok").toBool()){
+        qDebug() << response.value("error").toString();
+        return 1;
+    }
+
+    return 0;
+}
+
+bool ConversionServer::getJobUInt(const QJsonObject& obj, const QString& key, uint32_t def, uint32_t max,
+                                  uint32_t* value, QString* error)
+{
+    if(!obj.contains(key)){
+        *value = def;
+        return true;
+    }
+
+    // Преобразование вне диапазона uint32_t не определено.
+    double d = obj.value(key).toDouble(-1);
+
+    if(d < 0 || d > max || d != static_cast<double>(static_cast<uint32_t>(d))){
+        *error = tr("Invalid \"%1\" value, expected integer 0..%2").arg(key).arg(max);
+        return false;
+    }
+
+    *value = static_cast<uint32_t>(d);
+
+    return true;
+}
+
+bool ConversionServer::getJobRange(const QJsonObject& obj, uint32_t* first, uint32_t* last, QString* error)
+{
+    if(!getJobUInt(obj, "first", 0, UINT32_MAX, first, error)) return false;
+    if(!getJobUInt(obj, "last", UINT32_MAX, UINT32_MAX, last, error)) return false;
+
+    if(*first > *last){
+        *error = tr("Invalid char range: %1..%2").arg(*first).arg(*last);
+        return false;
+    }
+
+    return true;
+}
+
+bool ConversionServer::runJob(FontConverter* converter, const QJsonObject& job, QString* error)
+{
+    // Имя шрифта входит в имена переменных и макросов C.
+    static const QRegularExpression font_name_re("^[A-Za-z_][A-Za-z0-9_]*$");
+
+    QDir dir(job.value("dir").toString(QDir::currentPath()));
+
+    converter->clear();
+
+    QJsonArray inputs = job.value("inputs").toArray();
+    QJsonArray outputs = job.value("outputs").toArray();
+
+    if(inputs.isEmpty()){
+        *error = tr("Job has no inputs");
+        return false;
+    }
+
+    if(outputs.isEmpty()){
+        *error = tr("Job has no outputs");
+        return false;
+    }
+
+    for(const QJsonValue& it: inputs){
+        QJsonObject input = it.toObject();
+
+        QString file = input.value("file").toString();
+        if(file.isEmpty()){
+            *error = tr("Input has no file");
+            return false;
+        }
+
+        uint32_t first, last;
+        if(!getJobRange(input, &first, &last, error)) return false;
+
+        converter->addFontInterval(dir.absoluteFilePath(file), first, last);
+    }
+
+    for(const QJsonValue& it: job.value("overrides").toArray()){
+        QJsonObject override = it.toObject();
+
+        if(!override.contains("char")){
+            *error = tr("Override has no char");
+            return false;
+        }
+
+        uint32_t char_code, x, y;
+        if(!getJobUInt(override, "char", 0, UINT32_MAX, &char_code, error)) return false;
+        if(!getJobUInt(override, "x", 0, INT_MAX, &x, error)) return false;
+        if(!getJobUInt(override, "y", 0, INT_MAX, &y, error)) return false;
+
+        QSize size;
+        if(override.contains("width") && override.contains("height")){
+            uint32_t width, height;
+            if(!getJobUInt(override, "width", 0, INT_MAX, &width, error)) return false;
+            if(!getJobUInt(override, "height", 0, INT_MAX, &height, error)) return false;
+
+            size = QSize(width, height);
+        }
+
+        converter->addGlyphSizeOverride(char_code, QPoint(x, y), size);
+    }
+
+    for(const QJsonValue& it: outputs){
+        QJsonObject output = it.toObject();
+
+        QString file = output.value("file").toString();
+        if(file.isEmpty()){
+            *error = tr("Output has no file");
+            return false;
+        }
+
+        QString font = output.value("font").toString();
+        if(!font_name_re.match(font).hasMatch()){
+            *error = tr("Invalid output font name: %1").arg(font);
+            return false;
+        }
+
+        uint32_t first, last;
+        if(!getJobRange(output, &first, &last, error)) return false;
+
+        converter->addOutput(dir.absoluteFilePath(file), font,
+                             (output.value("layout").toString() == "horizontal") ?
+                                 FontConverter::ByteHorizontal : FontConverter::ByteVertical,
+                             first, last);
+    }
+
+    for(const QJsonValue& it: job.value("strings").toArray()){
+        QJsonObject str = it.toObject();
+
+        if(!converter->addStaticString(str.value("name").toString(), str.value("text").toString())){
+            *error = tr("Invalid or duplicate static string name: %1").arg(str.value("name").toString());
+            return false;
+        }
+    }
+
+    converter->setOptimizeLayout(job.value("optimize").toBool(false));
+
+    QString monospace = job.value("monospace").toString("off");
+    if(monospace == "auto"){
+        converter->setMonospaceMode(FontConverter::MonospaceAuto);
+    }else if(monospace == "forced"){
+        converter->setMonospaceMode(FontConverter::MonospaceForced);
+    }else{
+        converter->setMonospaceMode(FontConverter::MonospaceOff);
+    }
+
+    QString descrs = job.value("descriptors").toString("full");
+    if(descrs == "narrow"){
+        converter->setDescrFormat(FontConverter::DescrNarrow);
+    }else if(descrs == "bitfield"){
+        converter->setDescrFormat(FontConverter::DescrBitfield);
+    }else{
+        converter->setDescrFormat(FontConverter::DescrFull);
+    }
+
+    converter->setDescrArrays(job.value("arrays").toBool(false));
+
+    converter->setRowSpans(job.value("spans").toBool(false));
+
+    uint32_t hspace;
+    if(!getJobUInt(job, "hspace", 1, UCHAR_MAX, &hspace, error)) return false;
+
+    converter->setFontHSpace(hspace);
+
+    if(!converter->convert()){
+        *error = converter->errorString();
+        if(error->isEmpty()) *error = tr("Conversion failed");
+        return false;
+    }
+
+    return true;
+}
+
+void ConversionServer::newConnection()
+{
+    while(server->hasPendingConnections()){
+        QLocalSocket* socket = server->nextPendingConnection();
+
+        connect(socket, &QLocalSocket::readyRead, this, &ConversionServer::readJob);
+        connect(socket, &QLocalSocket::disconnected, socket, &QLocalSocket::deleteLater);
+    }
+}
+
+void ConversionServer::readJob()
+{
+    QLocalSocket* socket = qobject_cast<QLocalSocket*>(sender());
+    if(socket == nullptr) return;
+
+    while(socket->canReadLine()){
+        QByteArray line = socket->readLine().trimmed();
+
+        if(line.isEmpty()) continue;
+
+        socket->write(processJob(line));
+        socket->write("\n");
+        socket->flush();
+    }
+}
+
+QByteArray ConversionServer::processJob(const QByteArray& job)
+{
+    QJsonParseError parse_error;
+    QJsonDocument doc = QJsonDocument::fromJson(job, &parse_error);
+
+    if(!doc.isObject()){
+        return makeResponse(false, tr("Error parsing job: %1").arg(parse_error.errorString()));
+    }
+
+    QString error;
+
+    if(!runJob(font_converter, doc.object(), &error)){
+        return makeResponse(false, error);
+    }
+
+    return makeResponse(true, QString());
+}
+
+QByteArray ConversionServer::makeResponse(bool ok, const QString& error)
+{
+    QJsonObject response;
+
+    response.insert("ok", ok);
+    if(!ok) response.insert("error", error);
+
+    return QJsonDocument(response).toJson(QJsonDocument::Compact);
+}
@@ -0,0 +1,82 @@
+#ifndef CONVERSIONSERVER_H
+#define CONVERSIONSERVER_H
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QJsonObject>
+#include <stdint.h>
+
+
+class QLocalServer;
+class FontConverter;
+
+
+/**
+ * @brief Сервер преобразования шрифтов.
+ * Принимает задания по одному JSON-объекту в строке
+ * через локальный сокет или стандартный ввод
+ * и хранит прочитанные шрифты между заданиями.
+ */
+class ConversionServer : public QObject
+{
+    Q_OBJECT
+public:
+
+    explicit ConversionServer(QObject *parent = 0);
+    ~ConversionServer();
+
+    /**
+     * @brief Начинает приём заданий через локальный сокет.
+     * @param name Имя локального сокета.
+     * @return Флаг успеха.
+     */
+    bool listen(const QString& name);
+
+    /**
+     * @brief Выполняет задания со стандартного ввода
+     * до его окончания, ответы выводятся в стандартный вывод.
+     * @return Код завершения.
+     */
+    int runStdio();
+
+    /**
+     * @brief Отправляет задание серверу и ждёт ответа.
+     * Если сервер недоступен, задание выполняется локально.
+     * @param name Имя локального сокета.
+     * @param job Задание.
+     * @return Код завершения.
+     */
+    static int runClient(const QString& name, const QByteArray& job);
+
+    /**
+     * @brief Выполняет задание.
+     * @param converter Преобразователь шрифта.
+     * @param job Задание.
+     * @param error Сообщение об ошибке.
+     * @return Флаг успеха.
+     */
+    static bool runJob(FontConverter* converter, const QJsonObject& job, QString* error);
+
+signals:
+
+public slots:
+
+private slots:
+    void newConnection();
+    void readJob();
+
+private:
+    //! Локальный сервер.
+    QLocalServer* server;
+    //! Преобразователь шрифта с кэшем шрифтов.
+    FontConverter* font_converter;
+
+    QByteArray processJob(const QByteArray& job);
+    static QByteArray makeResponse(bool ok, const QString& error);
+    static bool getJobUInt(const QJsonObject& obj, const QString& key, uint32_t def, uint32_t max,
+                           uint32_t* value, QString* error);
+    static bool getJobRange(const QJsonObject& obj, uint32_t* first, uint32_t* last, QString* error);
+};
+
+#endif // CONVERSIONSERVER_H
@@ -4,9 +4,9 @@
 #
 #-------------------------------------------------
 
-QT       += core gui
+QT       += core gui network
 
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets concurrent
 
 TARGET = fontconvert
 TEMPLATE = app
@@ -14,10 +14,12 @@ TEMPLATE = app
 
 SOURCES += main.cpp\
         mainwindow.cpp \
-    fontconverter.cpp
+    fontconverter.cpp \
+    conversionserver.cpp
 
 HEADERS  += mainwindow.h \
-    fontconverter.h
+    fontconverter.h \
+    conversionserver.h
 
 FORMS    += mainwindow.ui
 
@@ -1,28 +1,54 @@
 #include "fontconverter.h"
 #include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QSet>
+#include <QDateTime>
 #include <QXmlStreamReader>
 #include <QStringRef>
 #include <QStringList>
+#include <QRegularExpression>
 #include <QColor>
 #include <QPainter>
 #include <algorithm>
 #include <iterator>
 #include <math.h>
+#include <limits.h>
 #include <QTextStream>
 #include <QChar>
 #include <QDebug>
+#include <QVector>
+#include <QtConcurrent>
 
 
+//! Имена полей дескриптора символа.
+static const char* const descr_field_names[] = {
+    "x", "y", "width", "height", "offset_x", "offset_y"
+};
+
 FontConverter::FontConverter(QObject *parent) : QObject(parent)
 {
     inputs = new QList<FontInput>();
+    outputs = new QList<FontOutput>();
+    staticStrings = new QList<StaticString>();
     glyphOverrides = new QHash<uint32_t, GlyphSizeOverride>();
     byte_layout = ByteVertical;
+    optimize_layout = false;
+    descr_format = DescrFull;
+    descr_arrays = false;
+    monospace_mode = MonospaceOff;
+    row_spans = false;
+    font_hspace = 1;
+    font_caching = false;
+    fontCache = new QCache<QString, FontCache>(font_cache_size);
 }
 
 FontConverter::~FontConverter()
 {
     delete glyphOverrides;
+    delete fontCache;
+    delete staticStrings;
+    delete outputs;
     delete inputs;
 }
 
@@ -31,9 +57,52 @@ void FontConverter::setByteLayout(FontConverter::ByteLayout layout)
     byte_layout = layout;
 }
 
+void FontConverter::setOptimizeLayout(bool optimize)
+{
+    optimize_layout = optimize;
+}
+
+void FontConverter::setDescrFormat(FontConverter::DescrFormat format)
+{
+    descr_format = format;
+}
+
+void FontConverter::setDescrArrays(bool arrays)
+{
+    descr_arrays = arrays;
+}
+
+void FontConverter::setMonospaceMode(FontConverter::MonospaceMode mode)
+{
+    monospace_mode = mode;
+}
+
+void FontConverter::setFontCaching(bool caching)
+{
+    font_caching = caching;
+    if(!font_caching) fontCache->clear();
+}
+
+void FontConverter::clearFontCache()
+{
+    fontCache->clear();
+}
+
+void FontConverter::setRowSpans(bool spans)
+{
+    row_spans = spans;
+}
+
+void FontConverter::setFontHSpace(uint32_t hspace)
+{
+    font_hspace = hspace;
+}
+
 void FontConverter::clear()
 {
     inputs->clear();
+    outputs->clear();
+    staticStrings->clear();
     glyphOverrides->clear();
 }
 
@@ -42,51 +111,240 @@ void FontConverter::addFontInterval(const QString& fileName, uint32_t firstChar,
     inputs->append(FontInput(fileName, firstChar, lastChar));
 }
 
+void FontConverter::addOutput(const QString& fileName, const QString& fontName, FontConverter::ByteLayout layout, uint32_t firstChar, uint32_t lastChar)
+{
+    outputs->append(FontOutput(fileName, fontName, layout, firstChar, lastChar));
+}
+
+bool FontConverter::addStaticString(const QString& name, const QString& text)
+{
+    // Имя входит в имена переменных и макросов C.
+    static const QRegularExpression name_re("^[A-Za-z_][A-Za-z0-9_]*$");
+
+    if(!name_re.match(name).hasMatch()){
+        qDebug() << tr("Invalid static string name: %1").arg(name);
+        return false;
+    }
+
+    // Имена макросов в верхнем регистре, имена не должны различаться только регистром.
+    for(const StaticString& it: *staticStrings){
+        if(QString::compare(it.name, name, Qt::CaseInsensitive) == 0){
+            qDebug() << tr("Duplicate static string name: %1").arg(name);
+            return false;
+        }
+    }
+
+    staticStrings->append(StaticString(name, text));
+
+    return true;
+}
+
 void FontConverter::addGlyphSizeOverride(uint32_t char_code, const QPoint& pos, const QSize& size)
 {
     glyphOverrides->insert(char_code, GlyphSizeOverride(pos, size));
 }
 
+QString FontConverter::errorString() const
+{
+    QMutexLocker locker(&error_mutex);
+
+    return error_string;
+}
+
+void FontConverter::setError(const QString& error) const
+{
+    qDebug() << error;
+
+    QMutexLocker locker(&error_mutex);
+
+    // Последующие ошибки обычно следствие первой.
+    if(error_string.isEmpty()) error_string = error;
+}
+
 bool FontConverter::convert(const QString& fileName, const QString& fontName) const
 {
-    if(inputs->empty()){
-        qDebug() << tr("Nothing to convert");
+    error_string.clear();
+
+    QList<FontData> font_data_list;
+    bool monospace = false;
+
+    if(!loadFonts(&font_data_list, &monospace)) return false;
+
+    return convertOutput(FontOutput(fileName, fontName, byte_layout, 0, UINT32_MAX), font_data_list, monospace);
+}
+
+bool FontConverter::convert() const
+{
+    error_string.clear();
+
+    if(outputs->empty()){
+        setError(tr("No outputs to convert"));
         return false;
     }
 
-    QFile file(fileName);
+    // Выходы с одним файлом записывали бы его одновременно.
+    QSet<QString> out_files;
 
-    if(!file.open(QIODevice::WriteOnly)){
-        qDebug() << tr("Error opening output file: %1").arg(fileName);
-        return false;
+    for(const FontOutput& it: *outputs){
+        QFileInfo fi(it.fileOut);
+        QString path = fi.canonicalFilePath();
+
+        // Файл ещё не создан, разрешается только каталог.
+        if(path.isEmpty()){
+            QString dir_path = QFileInfo(fi.absolutePath()).canonicalFilePath();
+            path = dir_path.isEmpty() ? fi.absoluteFilePath() : QDir(dir_path).filePath(fi.fileName());
+        }
+
+        if(out_files.contains(path)){
+            setError(tr("Duplicate output file: %1").arg(it.fileOut));
+            return false;
+        }
+
+        out_files.insert(path);
     }
 
     QList<FontData> font_data_list;
+    bool monospace = false;
+
+    if(!loadFonts(&font_data_list, &monospace)) return false;
+
+    // Упаковка и экспорт каждого выхода параллельно из общих глифов.
+    QList<bool> results = QtConcurrent::blockingMapped<QList<bool>>(*outputs,
+        [this, &font_data_list, monospace](const FontOutput& fout){
+            return convertOutput(fout, font_data_list, monospace);
+        });
+
+    return !results.contains(false);
+}
+
+bool FontConverter::loadFonts(QList<FontData>* font_data_list, bool* monospace) const
+{
+    if(inputs->empty()){
+        setError(tr("Nothing to convert"));
+        return false;
+    }
+
+    QString cache_key;
+
+    if(font_caching){
+        cache_key = fontCacheKey();
+
+        FontCache* fc = fontCache->object(cache_key);
+
+        if(fc != nullptr){
+            qDebug() << tr("Using cached fonts");
+            *font_data_list = fc->fonts;
+            *monospace = fc->monospace;
+            return true;
+        }
+    }
 
     for(auto it: *inputs){
-        if(!convertInterval(it, &font_data_list)){
-            qDebug() << "Error reading font:" << it.fileIn;
-            file.close();
+        if(!convertInterval(it, font_data_list)){
+            setError(tr("Error reading font: %1").arg(it.fileIn));
             return false;
         }
     }
 
     {
         QList<FontData> font_data_list_sorted;
-        while(!font_data_list.isEmpty()){
-            auto& fd = font_data_list.first();
+        while(!font_data_list->isEmpty()){
+            auto& fd = font_data_list->first();
 
             auto it = std::lower_bound(font_data_list_sorted.begin(), font_data_list_sorted.end(), fd, [](const FontData& lfd, const FontData& rfd){
                 return lfd.char_from < rfd.char_from;
             });
 
-            font_data_list_sorted.insert(it, std::move(font_data_list.takeFirst()));
+            font_data_list_sorted.insert(it, std::move(font_data_list->takeFirst()));
+        }
+        font_data_list->swap(font_data_list_sorted);
+    }
+
+    QSize cell_size;
+
+    if(!checkMonospace(*font_data_list, monospace, &cell_size)) return false;
+
+    if(*monospace){
+        cellFont(font_data_list, cell_size);
+    }else{
+        trimFont(font_data_list);
+    }
+
+    if(font_caching){
+        fontCache->insert(cache_key, new FontCache(*font_data_list, *monospace));
+    }
+
+    return true;
+}
+
+QString FontConverter::fontCacheKey() const
+{
+    QStringList key;
+
+    for(const FontInput& it: *inputs){
+        QFileInfo fi(it.fileIn);
+
+        key << QString("%1:%2:%3:%4:%5").arg(fi.absoluteFilePath()).arg(it.firstChar).arg(it.lastChar)
+                                        .arg(fi.lastModified().toMSecsSinceEpoch()).arg(fi.size());
+    }
+
+    QList<uint32_t> override_chars = glyphOverrides->keys();
+    std::sort(override_chars.begin(), override_chars.end());
+
+    for(uint32_t char_code: override_chars){
+        const GlyphSizeOverride& gso = (*glyphOverrides)[char_code];
+
+        key << QString("%1:%2,%3:%4x%5").arg(char_code).arg(gso.pos.x()).arg(gso.pos.y())
+                                       .arg(gso.size.width()).arg(gso.size.height());
+    }
+
+    key << QString("monospace:%1").arg(monospace_mode);
+
+    return key.join("|");
+}
+
+bool FontConverter::convertOutput(const FontConverter::FontOutput& fout, const QList<FontConverter::FontData>& font_data_list, bool monospace) const
+{
+    QList<FontData> out_data_list;
+
+    for(const FontData& it: font_data_list){
+        FontData fd(it);
+
+        if(it.char_from < fout.firstChar || it.char_to > fout.lastChar){
+            fd.glyphs.clear();
+
+            for(GlyphList::const_iterator jt = it.glyphs.constBegin(); jt != it.glyphs.constEnd(); ++ jt){
+                if(jt.key() >= fout.firstChar && jt.key() <= fout.lastChar){
+                    fd.glyphs.insert(jt.key(), jt.value());
+                }
+            }
+
+            if(fd.glyphs.isEmpty()) continue;
+
+            updateBitmapSize(fd);
         }
-        font_data_list.swap(font_data_list_sorted);
+
+        out_data_list.append(fd);
+    }
+
+    if(out_data_list.isEmpty()){
+        setError(tr("No chars to export: %1").arg(fout.fileOut));
+        return false;
+    }
+
+    if(optimize_layout){
+        optimizeLayout(&out_data_list, fout.byteLayout, monospace);
+    }
+
+    QFile file(fout.fileOut);
+
+    if(!file.open(QIODevice::WriteOnly)){
+        setError(tr("Error opening output file: %1").arg(fout.fileOut));
+        return false;
     }
 
-    if(!exportFont(file, fontName, &font_data_list)){
-        qDebug() << "Error exporting font!";
+    if(!exportFont(file, fout.fontName, fout.byteLayout, monospace, &out_data_list)){
+        setError(tr("Error exporting font: %1").arg(fout.fileOut));
         file.close();
         return false;
     }
@@ -101,7 +359,7 @@ bool FontConverter::convertInterval(const FontConverter::FontInput& fin, QList<F
     QFile file(fin.fileIn);
 
     if(!file.open(QIODevice::ReadOnly)){
-        qDebug() << tr("Error open input file: %1").arg(fin.fileIn);
+        setError(tr("Error open input file: %1").arg(fin.fileIn));
         return false;
     }
 
@@ -196,22 +454,10 @@ QImage FontConverter::pixelsStrToImage(const QString& pixelsStr, uint32_t width,
     return imgres;
 }
 
-bool FontConverter::exportFont(QFile& outFile, const QString& fontName, QList<FontConverter::FontData>* font_data_list) const
+bool FontConverter::exportFont(QFile& outFile, const QString& fontName, ByteLayout layout, bool monospace, QList<FontConverter::FontData>* font_data_list) const
 {
     for(FontData& it: *font_data_list){
-
-        it.bitmap_width = 0;
-        it.bitmap_height = 0;
-
-        for(GlyphList::iterator jt = it.glyphs.begin(); jt != it.glyphs.end(); ++ jt){
-            trimGlyph(jt.key(), jt.value());
-
-            if(jt.value().data.height() > static_cast<int>(it.bitmap_height)){
-                it.bitmap_height = jt.value().data.height();
-            }
-
-            it.bitmap_width += jt.value().data.width();
-        }
+        updateBitmapSize(it);
 
         //qDebug() << it.glyphs.firstKey() << it.glyphs.lastKey();
         //qDebug() << it.bitmap_width << it.bitmap_height;
@@ -243,22 +489,54 @@ bool FontConverter::exportFont(QFile& outFile, const QString& fontName, QList<Fo
     ts << "#define " << upFontName << "_BITMAPS_COUNT " << font_data_list->size() << Qt::endl;
     ts << "#define " << upFontName << "_MAX_CHAR_WIDTH " << max_char_width << Qt::endl;
     ts << "#define " << upFontName << "_MAX_CHAR_HEIGHT " << max_char_height << Qt::endl;
-    ts << "#define " << upFontName << "_DEF_HSPACE " << 1 << Qt::endl;
+    ts << "#define " << upFontName << "_DEF_HSPACE " << font_hspace << Qt::endl;
     ts << "#define " << upFontName << "_DEF_VSPACE " << 0 << Qt::endl;
-    ts << "#define " << upFontName << "_DEF_CHAR " << 127 << Qt::endl;
+    ts << "#define " << upFontName << "_DEF_CHAR " << font_def_char << Qt::endl;
+
+    uint32_t fields_max[descr_fields_count];
+    int fields_bits[descr_fields_count];
+
+    getDescrFieldsMax(*font_data_list, fields_max);
+    getDescrFieldsBits(fields_max, fields_bits);
+
+    if(!monospace){
+        exportDescrType(ts, fontName, fields_bits);
+    }
 
     int part_n = 0;
 
     int origin_width, origin_height;
 
+    // Количество записываемых пикселей без и с учётом строк глифов.
+    uint32_t box_pixels = 0;
+    uint32_t span_pixels = 0;
+
+    // Типы таблиц строк общие для всех частей, как и в оценке размера.
+    uint32_t spans_max_width = 0;
+    uint32_t spans_count = 0;
+
+    getSpansMax(*font_data_list, &spans_max_width, &spans_count);
+
+    uint32_t span_size = spanSize(spans_max_width);
+    uint32_t span_index_size = spanIndexSize(spans_count);
+
     for(FontData& it: *font_data_list){
 
         ts << "\n\n";
 
+        if(monospace){
+            exportMonospacePart(ts, fontName, part_n, layout, it);
+            if(row_spans){
+                exportRowSpans(ts, fontName, part_n, monospace, it, span_size, span_index_size, &box_pixels, &span_pixels);
+            }
+            part_n ++;
+            continue;
+        }
+
         origin_width = 0;
         origin_height = 0;
 
-        if(byte_layout == ByteVertical){
+        if(layout == ByteVertical){
             origin_width = it.bitmap_width;
             origin_height = getFract8(it.bitmap_height);
         }else{
@@ -267,7 +545,7 @@ bool FontConverter::exportFont(QFile& outFile, const QString& fontName, QList<Fo
         }
 
         ts << "#define " << upFontName << "_PART" << part_n << "_GRAPHICS_FORMAT "
-           << ((byte_layout == ByteVertical) ? "GRAPHICS_FORMAT_BW_1_V" : "GRAPHICS_FORMAT_BW_1_H") << "\n";
+           << ((layout == ByteVertical) ? "GRAPHICS_FORMAT_BW_1_V" : "GRAPHICS_FORMAT_BW_1_H") << "\n";
         ts << "#define " << upFontName << "_PART" << part_n << "_WIDTH " << origin_width << "\n";
         ts << "#define " << upFontName << "_PART" << part_n << "_HEIGHT " << origin_height << "\n";
         ts << "#define " << upFontName << "_PART" << part_n << "_FIRST_CHAR " << it.glyphs.firstKey() << "\n";
@@ -283,23 +561,33 @@ bool FontConverter::exportFont(QFile& outFile, const QString& fontName, QList<Fo
 
         int cur_x = 0;
 
-        ts << "#define " << upFontName << "_PART" << part_n << "_DESCRS_COUNT "
-           << it.glyphs.size() << "\n";
-        ts << "static const font_char_descr_t " << fontName << "_part" << part_n << "_descrs"
-           << "[" << upFontName << "_PART" << part_n << "_DESCRS_COUNT" << "] = {\n";
+        // Дескрипторы всех символов диапазона части.
+        QVector<QVector<uint32_t>> descrs;
+
+        uint32_t cur_char = it.glyphs.firstKey();
 
         for(GlyphList::iterator jt = it.glyphs.begin(); jt != it.glyphs.end(); ++ jt){
 
-            ts << "    " << "{" << cur_x << ", " << 0 << ", "
-               << jt.value().data.width() << ", " << jt.value().data.height() << ", "
-               << jt.value().offset_x << ", " << jt.value().offset_y << "},"
-               << " // " << jt.key() << "\n";
+            // Пропуски в диапазоне символов части.
+            for(; cur_char < jt.key(); cur_char ++){
+                descrs.append(QVector<uint32_t>(descr_fields_count, 0));
+            }
+            cur_char ++;
+
+            descrs.append(QVector<uint32_t>({static_cast<uint32_t>(cur_x), 0,
+                                             static_cast<uint32_t>(jt.value().data.width()),
+                                             static_cast<uint32_t>(jt.value().data.height()),
+                                             jt.value().offset_x, jt.value().offset_y}));
 
             painter.drawImage(cur_x, 0, jt.value().data);
             cur_x += jt.value().data.width();
         }
 
-        ts << "};\n";
+        exportDescrs(ts, fontName, part_n, it.glyphs.firstKey(), descrs, fields_bits);
+
+        if(row_spans){
+            exportRowSpans(ts, fontName, part_n, monospace, it, span_size, span_index_size, &box_pixels, &span_pixels);
+        }
 
         ts << "\n";
 
@@ -308,35 +596,7 @@ bool FontConverter::exportFont(QFile& outFile, const QString& fontName, QList<Fo
         ts << "static const uint8_t " << fontName << "_part" << part_n << "_data"
            << "[" << upFontName << "_PART" << part_n << "_DATA_SIZE" << "] = {\n";
 
-        int line_len = 0;
-        for(int y = 0; y < origin_height;){
-            for(int x = 0; x < origin_width;){
-
-                if(line_len == 0) ts << "    ";
-
-                ts << QString("0x%1").arg(static_cast<unsigned int>(getImageByte(bitmap_img, x, y, byte_layout)), 2, 16, QChar('0'));
-
-                if(++ line_len < 16){
-                    ts << ", ";
-                }else{
-                    ts << ",\n";
-                    line_len = 0;
-                }
-
-                if(byte_layout == ByteVertical){
-                    x ++;
-                }else{
-                    x += 8;
-                }
-            }
-            if(byte_layout == ByteVertical){
-                y += 8;
-            }else{
-                y ++;
-            }
-        }
-
-        if(line_len != 0) ts << "\n";
+        exportBitmapData(ts, bitmap_img, origin_width, origin_height, layout);
 
         ts << "};\n";
 
@@ -346,14 +606,78 @@ bool FontConverter::exportFont(QFile& outFile, const QString& fontName, QList<Fo
     }
 
 
+    if(row_spans){
+        qDebug() << tr("%1: row spans save %2 of %3 pixel writes")
+                    .arg(fontName).arg(box_pixels - span_pixels).arg(box_pixels);
+    }
+
+    exportStaticStrings(ts, fontName, layout, *font_data_list);
+
+
     // Export font declaration.
     ts << "\n\n/*" << Qt::endl;
     ts << "#include \"" << fontName << ".h" << "\"\n\n" << Qt::endl;
 
+    if(row_spans){
+        /*
+         * Таблицы строк не входят в font_bitmap_t и дескрипторы,
+         * отрисовка находит их по имени части.
+         */
+        ts << "// Row spans are not referenced by font_bitmap_t, row r of char c in part N with "
+           << upFontName << "_PARTN_SPANS_COUNT != 0:" << Qt::endl;
+
+        for(int i = 0; i < font_data_list->size(); i ++){
+            if(monospace){
+                ts << QString("// part %3: %2_part%3_spans[(c - %1_PART%3_FIRST_CHAR) * %1_PART%3_CHAR_HEIGHT + r]")
+                      .arg(upFontName).arg(fontName).arg(i) << Qt::endl;
+            }else{
+                ts << QString("// part %3: %2_part%3_spans[%2_part%3_span_index[c - %1_PART%3_FIRST_CHAR] + r]")
+                      .arg(upFontName).arg(fontName).arg(i) << Qt::endl;
+            }
+        }
+
+        ts << Qt::endl;
+    }
+
+    if(monospace){
+        ts << "// Monospace font: char data at <part data> + (c - <part first char>) * <part cell bytes>" << Qt::endl;
+    }else if(descr_format != DescrFull || descr_arrays){
+        /*
+         * font_bitmap_t принимает только font_char_descr_t,
+         * компактные дескрипторы читаются отдельным методом доступа.
+         */
+        ts << "// Font descriptors: " << descrTypeName(fontName)
+           << (descr_arrays ? " arrays" : "") << ", " << descrSize(fields_bits) << " bytes per char." << Qt::endl;
+        ts << "// font_bitmap_t accepts font_char_descr_t only," << Qt::endl;
+        ts << "// the parts need a renderer with a format-aware descriptor accessor:" << Qt::endl;
+
+        for(int i = 0; i < font_data_list->size(); i ++){
+            QString descrs_name = descr_arrays ?
+                        QString("%1_part%2_descrs_<field>").arg(fontName).arg(i) :
+                        QString("%1_part%2_descrs").arg(fontName).arg(i);
+
+            ts << QString("// part %3: %1_PART%3_FIRST_CHAR..%1_PART%3_LAST_CHAR, data %2_part%3_data, "
+                          "descriptor %4[c - %1_PART%3_FIRST_CHAR]")
+                  .arg(upFontName).arg(fontName).arg(i).arg(descrs_name) << Qt::endl;
+        }
+
+        ts << "*/" << Qt::endl;
+
+        ts << "\n\n#endif\t //" << fontName.toUpper() << "_H\n";
+
+        return true;
+    }
+
     ts << "// Font bitmaps: " << fontName << Qt::endl;
     ts << "static const font_bitmap_t " << fontName << "_bitmaps[] = {" << Qt::endl;
     int cur_part_n = 0;
-    std::for_each(font_data_list->begin(), font_data_list->end(), [&ts, &cur_part_n, &fontName, &upFontName](FontConverter::FontData&){
+    std::for_each(font_data_list->begin(), font_data_list->end(), [&ts, &cur_part_n, &fontName, &upFontName, monospace](FontConverter::FontData&){
+        if(monospace){
+            ts << "    make_font_bitmap("
+               << QString("%1_PART%3_FIRST_CHAR, %1_PART%3_LAST_CHAR, %2_part%3_data, %1_PART%3_WIDTH, %1_PART%3_HEIGHT, %1_PART%3_GRAPHICS_FORMAT)").arg(upFontName).arg(fontName).arg(cur_part_n) << "," << Qt::endl;
+            cur_part_n ++;
+            return;
+        }
         ts << "    make_font_bitmap_descrs("
            << QString("%1_PART%3_FIRST_CHAR, %1_PART%3_LAST_CHAR, %2_part%3_data, %1_PART%3_WIDTH, %1_PART%3_HEIGHT, %1_PART%3_GRAPHICS_FORMAT, %2_part%3_descrs)").arg(upFontName).arg(fontName).arg(cur_part_n) << "," << Qt::endl;
         cur_part_n ++;
@@ -367,7 +691,7 @@ bool FontConverter::exportFont(QFile& outFile, const QString& fontName, QList<Fo
        << upFontName << "_BITMAPS_COUNT, "
        << upFontName << "_MAX_CHAR_WIDTH, "
        << upFontName << "_MAX_CHAR_HEIGHT, "
-       << 0 << ", "
+       << upFontName << "_DEF_HSPACE, "
        << upFontName << "_DEF_VSPACE, "
        << upFontName << "_DEF_CHAR);" << Qt::endl;
 
@@ -378,6 +702,1032 @@ bool FontConverter::exportFont(QFile& outFile, const QString& fontName, QList<Fo
     return true;
 }
 
+void FontConverter::trimFont(QList<FontConverter::FontData>* font_data_list) const
+{
+    for(FontData& it: *font_data_list){
+        for(GlyphList::iterator jt = it.glyphs.begin(); jt != it.glyphs.end(); ++ jt){
+            trimGlyph(jt.key(), jt.value());
+        }
+        updateBitmapSize(it);
+    }
+}
+
+bool FontConverter::checkMonospace(const QList<FontConverter::FontData>& font_data_list, bool* monospace, QSize* cell_size) const
+{
+    *monospace = false;
+
+    if(monospace_mode == MonospaceOff) return true;
+    if(font_data_list.isEmpty()) return true;
+
+    bool forced = (monospace_mode == MonospaceForced);
+
+    const FontData& first_fd = font_data_list.first();
+
+    /*
+     * Ячейки разного размера сместили бы базовую линию,
+     * в принудительном режиме это ошибка.
+     */
+    for(const FontData& it: font_data_list){
+        if(it.char_width != first_fd.char_width || it.char_height != first_fd.char_height){
+            if(forced){
+                setError(tr("Error: monospace font with different char sizes: %1x%2 and %3x%4")
+                            .arg(first_fd.char_width).arg(first_fd.char_height)
+                            .arg(it.char_width).arg(it.char_height));
+                return false;
+            }
+            qDebug() << tr("Font is not monospace: different char sizes");
+            return true;
+        }
+    }
+
+    // Переопределение, вырезающее часть ячейки, требует дескриптора.
+    QSize font_cell_size(first_fd.char_width, first_fd.char_height);
+
+    for(auto it = glyphOverrides->constBegin(); it != glyphOverrides->constEnd(); ++ it){
+        if(it.value().size.isValid() && (it.value().pos != QPoint(0, 0) || it.value().size != font_cell_size)){
+            if(forced){
+                setError(tr("Error: monospace font with char %1 size overridden").arg(it.key()));
+                return false;
+            }
+            qDebug() << tr("Font is not monospace: char %1 size overridden").arg(it.key());
+            return true;
+        }
+
+        // Переопределение без размера стирает глиф, ячейка сохранила бы его пиксели.
+        if(!it.value().size.isValid()){
+            for(const FontData& fd: font_data_list){
+                GlyphList::const_iterator jt = fd.glyphs.constFind(it.key());
+
+                if(jt == fd.glyphs.constEnd() || getGlyphInkRight(jt.value().data) == 0) continue;
+
+                if(forced){
+                    setError(tr("Error: monospace font with char %1 blanked by override").arg(it.key()));
+                    return false;
+                }
+                qDebug() << tr("Font is not monospace: char %1 blanked by override").arg(it.key());
+                return true;
+            }
+        }
+    }
+
+    if(forced){
+        *monospace = true;
+        *cell_size = font_cell_size;
+        return true;
+    }
+
+    /*
+     * Символ на устройстве сдвигается на offset_x + ширину обрезанного глифа,
+     * то есть на правую границу закрашенных пикселей,
+     * шрифт моноширинный, если она у всех глифов одинакова.
+     */
+    int advance = 0;
+
+    for(const FontData& it: font_data_list){
+        for(GlyphList::const_iterator jt = it.glyphs.constBegin(); jt != it.glyphs.constEnd(); ++ jt){
+            int glyph_advance = getGlyphInkRight(jt.value().data);
+
+            // Пустой глиф обрезается до offset_x = ширине символа и сдвигает на неё.
+            if(glyph_advance == 0) glyph_advance = jt.value().data.width();
+
+            // Переопределение на всю ячейку сохраняет её ширину.
+            if(glyphOverrides->contains(jt.key()) && (*glyphOverrides)[jt.key()].size.isValid()){
+                glyph_advance = font_cell_size.width();
+            }
+
+            if(advance == 0){
+                advance = glyph_advance;
+            }else if(glyph_advance != advance){
+                qDebug() << tr("Font is not monospace: char %1 advance %2, expected %3")
+                            .arg(jt.key()).arg(glyph_advance).arg(advance);
+                return true;
+            }
+        }
+    }
+
+    if(advance == 0){
+        qDebug() << tr("Font is not monospace: no chars");
+        return true;
+    }
+
+    *monospace = true;
+    *cell_size = QSize(advance, first_fd.char_height);
+
+    return true;
+}
+
+int FontConverter::getGlyphInkRight(const QImage& img) const
+{
+    for(int x = img.width() - 1; x >= 0; x --){
+        for(int y = 0; y < img.height(); y ++){
+            if(getImagePixel(img, x, y) != 0) return x + 1;
+        }
+    }
+    return 0;
+}
+
+void FontConverter::cellFont(QList<FontConverter::FontData>* font_data_list, const QSize& cell_size) const
+{
+    uint32_t cell_width = cell_size.width();
+    uint32_t cell_height = cell_size.height();
+
+    qDebug() << tr("Monospace font: cell %1x%2").arg(cell_width).arg(cell_height);
+
+    for(FontData& it: *font_data_list){
+        it.char_width = cell_width;
+        it.char_height = cell_height;
+
+        for(GlyphList::iterator jt = it.glyphs.begin(); jt != it.glyphs.end(); ++ jt){
+            GlyphData& gd = jt.value();
+
+            gd.offset_x = 0;
+            gd.offset_y = 0;
+
+            if(gd.data.width() != static_cast<int>(cell_width) || gd.data.height() != static_cast<int>(cell_height)){
+                gd.data = gd.data.copy(0, 0, cell_width, cell_height);
+            }
+        }
+
+        updateBitmapSize(it);
+    }
+}
+
+void FontConverter::updateBitmapSize(FontConverter::FontData& font_data) const
+{
+    font_data.bitmap_width = 0;
+    font_data.bitmap_height = 0;
+
+    for(GlyphList::const_iterator it = font_data.glyphs.constBegin(); it != font_data.glyphs.constEnd(); ++ it){
+        if(it.value().data.height() > static_cast<int>(font_data.bitmap_height)){
+            font_data.bitmap_height = it.value().data.height();
+        }
+
+        font_data.bitmap_width += it.value().data.width();
+    }
+
+    if(!font_data.glyphs.isEmpty()){
+        font_data.char_from = font_data.glyphs.firstKey();
+        font_data.char_to = font_data.glyphs.lastKey();
+    }
+}
+
+void FontConverter::optimizeLayout(QList<FontConverter::FontData>* font_data_list, ByteLayout layout, bool monospace) const
+{
+    if(font_data_list->isEmpty()) return;
+
+    /*
+     * Все глифы по возрастанию кода.
+     * При пересечении частей остаётся глиф первой части,
+     * как и при поиске символа на устройстве.
+     */
+    QMap<uint32_t, int> glyph_parts;
+
+    for(int i = 0; i < font_data_list->size(); i ++){
+        const FontData& fd = font_data_list->at(i);
+        for(GlyphList::const_iterator it = fd.glyphs.constBegin(); it != fd.glyphs.constEnd(); ++ it){
+            if(!glyph_parts.contains(it.key())){
+                glyph_parts.insert(it.key(), i);
+            }
+        }
+    }
+
+    QVector<uint32_t> codes;
+    QVector<int> parts;
+    QVector<uint32_t> widths;
+    QVector<uint32_t> heights;
+
+    for(QMap<uint32_t, int>::const_iterator it = glyph_parts.constBegin(); it != glyph_parts.constEnd(); ++ it){
+        const QImage& img = font_data_list->at(it.value()).glyphs.constFind(it.key()).value().data;
+
+        codes.append(it.key());
+        parts.append(it.value());
+        widths.append(img.width());
+        heights.append(img.height());
+    }
+
+    int count = codes.size();
+
+    /*
+     * Размер дескриптора не зависит от разбиения,
+     * кроме ширины поля x - наибольшего начала глифа в части.
+     * Для каждого возможного размера дескриптора разбиение ищется
+     * с ограничением x наибольшим значением поля этого размера,
+     * из них выбирается наименьшее.
+     */
+    QList<QPair<uint32_t, uint32_t>> descr_candidates;
+
+    if(monospace){
+        descr_candidates.append(qMakePair(static_cast<uint32_t>(UINT32_MAX), static_cast<uint32_t>(0)));
+    }else{
+        uint32_t fields_max[descr_fields_count];
+        int fields_bits[descr_fields_count];
+
+        getDescrFieldsMax(*font_data_list, fields_max);
+
+        fields_max[0] = 0;
+        for(uint32_t width: widths){
+            fields_max[0] += width;
+        }
+
+        getDescrFieldsBits(fields_max, fields_bits);
+
+        uint32_t spans_max_width = 0;
+        uint32_t spans_count = 0;
+
+        getSpansMax(*font_data_list, &spans_max_width, &spans_count);
+
+        int max_x_bits = fields_bits[0];
+
+        for(int bits = 1; bits <= max_x_bits; bits ++){
+            fields_bits[0] = bits;
+
+            uint32_t size = descrSize(fields_bits);
+
+            // Индекс строк глифа на каждый символ.
+            if(row_spans) size += spanIndexSize(spans_count);
+
+            uint32_t x_limit = (bits == max_x_bits) ? UINT32_MAX : ((1u << bits) - 1);
+
+            if(!descr_candidates.isEmpty() && descr_candidates.last().second == size){
+                descr_candidates.last().first = x_limit;
+            }else{
+                descr_candidates.append(qMakePair(x_limit, size));
+            }
+        }
+    }
+
+    /*
+     * Наибольшее сокращение при объединении двух соседних частей:
+     * запись font_bitmap_t и выравнивание строк битовой карты
+     * (при горизонтальном расположении меньше байта на строку каждой части).
+     */
+    uint32_t max_height = 0;
+    for(uint32_t height: heights){
+        if(height > max_height) max_height = height;
+    }
+
+    uint64_t merge_saving = font_bitmap_size;
+    if(!monospace && layout == ByteHorizontal) merge_saving += 2 * max_height;
+
+    /*
+     * Динамическое программирование по разбиениям
+     * упорядоченной последовательности глифов:
+     * best[j] - минимальный размер для первых j глифов,
+     * prev[j] - начало последней части в этом разбиении.
+     * В одну часть объединяются только глифы
+     * с одинаковым размером символа.
+     */
+    uint64_t best_size = UINT64_MAX;
+    QVector<int> best_prev;
+
+    for(const QPair<uint32_t, uint32_t>& candidate: descr_candidates){
+        uint32_t x_limit = candidate.first;
+        uint32_t descr_size = candidate.second;
+
+        QVector<uint64_t> best(count + 1, UINT64_MAX);
+        QVector<int> prev(count + 1, 0);
+
+        best[0] = 0;
+
+        for(int j = 1; j <= count; j ++){
+            const FontData& last_fd = font_data_list->at(parts[j - 1]);
+
+            uint32_t bitmap_width = 0;
+            uint32_t bitmap_height = 0;
+
+            for(int i = j - 1; i >= 0; i --){
+                const FontData& fd = font_data_list->at(parts[i]);
+
+                if(fd.char_width != last_fd.char_width || fd.char_height != last_fd.char_height) break;
+
+                bitmap_width += widths[i];
+                if(heights[i] > bitmap_height) bitmap_height = heights[i];
+
+                // Начало последнего глифа части не помещается в поле x.
+                if(bitmap_width - widths[j - 1] > x_limit) break;
+
+                uint64_t size = best[i];
+
+                if(monospace){
+                    size += monospacePartSize(layout, codes[i], codes[j - 1], fd.char_width, fd.char_height);
+                }else{
+                    size += partSize(layout, descr_size, codes[i], codes[j - 1], bitmap_width, bitmap_height);
+                }
+
+                if(size < best[j]){
+                    best[j] = size;
+                    prev[j] = i;
+                }
+
+                /*
+                 * Часть, начинающаяся раньше i, не меньше разбиения
+                 * по пропуску перед i плюс его дескрипторы минус экономия объединения.
+                 * Если и это не лучше найденного, дальше расширять часть бесполезно.
+                 */
+                if(i > 0){
+                    uint64_t gap_size = static_cast<uint64_t>(codes[i] - codes[i - 1] - 1) *
+                            (monospace ? monospacePartSize(layout, 0, 0, fd.char_width, fd.char_height) - font_bitmap_size : descr_size);
+
+                    if(size + gap_size >= best[j] + merge_saving) break;
+                }
+            }
+        }
+
+        if(best[count] < best_size){
+            best_size = best[count];
+            best_prev = prev;
+        }
+    }
+
+    QList<FontData> optimized_list;
+
+    for(int j = count; j > 0; j = best_prev[j]){
+        FontData fd;
+
+        const FontData& src_fd = font_data_list->at(parts[j - 1]);
+
+        fd.char_width = src_fd.char_width;
+        fd.char_height = src_fd.char_height;
+
+        for(int i = best_prev[j]; i < j; i ++){
+            fd.glyphs.insert(codes[i], font_data_list->at(parts[i]).glyphs[codes[i]]);
+        }
+
+        updateBitmapSize(fd);
+
+        optimized_list.prepend(fd);
+    }
+
+    uint32_t naive_descr_size = layoutDescrSize(*font_data_list, monospace);
+    uint32_t optimized_descr_size = layoutDescrSize(optimized_list, monospace);
+
+    uint32_t naive_size = layoutSize(*font_data_list, layout, naive_descr_size, monospace);
+    uint32_t optimized_size = layoutSize(optimized_list, layout, optimized_descr_size, monospace);
+
+    printLayout(tr("Initial layout"), *font_data_list, layout, naive_descr_size, monospace);
+    printLayout(tr("Optimized layout"), optimized_list, layout, optimized_descr_size, monospace);
+
+    if(optimized_size < naive_size){
+        qDebug() << tr("Layout optimized: %1 -> %2 bytes").arg(naive_size).arg(optimized_size);
+        font_data_list->swap(optimized_list);
+    }else{
+        qDebug() << tr("Initial layout kept: %1 bytes").arg(naive_size);
+    }
+}
+
+uint32_t FontConverter::layoutDescrSize(const QList<FontConverter::FontData>& font_data_list, bool monospace) const
+{
+    if(monospace) return 0;
+
+    uint32_t fields_max[descr_fields_count];
+    int fields_bits[descr_fields_count];
+
+    getDescrFieldsMax(font_data_list, fields_max);
+    getDescrFieldsBits(fields_max, fields_bits);
+
+    uint32_t size = descrSize(fields_bits);
+
+    // Индекс строк глифа на каждый символ.
+    if(row_spans){
+        uint32_t spans_max_width = 0;
+        uint32_t spans_count = 0;
+
+        getSpansMax(font_data_list, &spans_max_width, &spans_count);
+
+        size += spanIndexSize(spans_count);
+    }
+
+    return size;
+}
+
+uint32_t FontConverter::partSize(ByteLayout layout, uint32_t descr_size, uint32_t first_char, uint32_t last_char, uint32_t bitmap_width, uint32_t bitmap_height) const
+{
+    uint32_t data_size = 0;
+
+    if(layout == ByteVertical){
+        data_size = bitmap_width * getFract8(bitmap_height) / 8;
+    }else{
+        data_size = getFract8(bitmap_width) * bitmap_height / 8;
+    }
+
+    return data_size + (last_char - first_char + 1) * descr_size + font_bitmap_size;
+}
+
+uint32_t FontConverter::monospacePartSize(ByteLayout layout, uint32_t first_char, uint32_t last_char, uint32_t char_width, uint32_t char_height) const
+{
+    uint32_t char_size = cellSize(layout, char_width, char_height);
+
+    // Строки глифа на каждую ячейку, все глифы шириной в ячейку.
+    if(row_spans) char_size += char_height * spanSize(char_width);
+
+    return (last_char - first_char + 1) * char_size + font_bitmap_size;
+}
+
+uint32_t FontConverter::cellSize(ByteLayout layout, uint32_t char_width, uint32_t char_height) const
+{
+    if(layout == ByteVertical){
+        return char_width * getFract8(char_height) / 8;
+    }
+    return getFract8(char_width) * char_height / 8;
+}
+
+uint32_t FontConverter::fontPartSize(const FontConverter::FontData& font_data, ByteLayout layout, uint32_t descr_size, bool monospace) const
+{
+    if(monospace){
+        return monospacePartSize(layout, font_data.char_from, font_data.char_to, font_data.char_width, font_data.char_height);
+    }
+    return partSize(layout, descr_size, font_data.char_from, font_data.char_to, font_data.bitmap_width, font_data.bitmap_height);
+}
+
+uint32_t FontConverter::layoutSize(const QList<FontConverter::FontData>& font_data_list, ByteLayout layout, uint32_t descr_size, bool monospace) const
+{
+    uint32_t size = 0;
+
+    for(const FontData& it: font_data_list){
+        size += fontPartSize(it, layout, descr_size, monospace);
+    }
+
+    return size;
+}
+
+void FontConverter::printLayout(const QString& title, const QList<FontConverter::FontData>& font_data_list, ByteLayout layout, uint32_t descr_size, bool monospace) const
+{
+    qDebug() << tr("%1: %2 parts, %3 bytes").arg(title).arg(font_data_list.size()).arg(layoutSize(font_data_list, layout, descr_size, monospace));
+
+    int part_n = 0;
+
+    for(const FontData& it: font_data_list){
+        qDebug() << tr("    part %1: %2..%3, %4 chars, bitmap %5x%6, %7 bytes")
+                    .arg(part_n).arg(it.char_from).arg(it.char_to).arg(it.glyphs.size())
+                    .arg(it.bitmap_width).arg(it.bitmap_height)
+                    .arg(fontPartSize(it, layout, descr_size, monospace));
+        part_n ++;
+    }
+}
+
+void FontConverter::getDescrFieldsMax(const QList<FontConverter::FontData>& font_data_list, uint32_t* fields_max) const
+{
+    for(int i = 0; i < descr_fields_count; i ++){
+        fields_max[i] = 0;
+    }
+
+    for(const FontData& it: font_data_list){
+        uint32_t cur_x = 0;
+
+        for(GlyphList::const_iterator jt = it.glyphs.constBegin(); jt != it.glyphs.constEnd(); ++ jt){
+            const GlyphData& gd = jt.value();
+
+            if(cur_x > fields_max[0]) fields_max[0] = cur_x;
+            if(static_cast<uint32_t>(gd.data.width()) > fields_max[2]) fields_max[2] = gd.data.width();
+            if(static_cast<uint32_t>(gd.data.height()) > fields_max[3]) fields_max[3] = gd.data.height();
+            if(gd.offset_x > fields_max[4]) fields_max[4] = gd.offset_x;
+            if(gd.offset_y > fields_max[5]) fields_max[5] = gd.offset_y;
+
+            cur_x += gd.data.width();
+        }
+    }
+}
+
+void FontConverter::getDescrFieldsBits(const uint32_t* fields_max, int* fields_bits) const
+{
+    for(int i = 0; i < descr_fields_count; i ++){
+        int bits = 1;
+        while(bits < 32 && (fields_max[i] >> bits) != 0) bits ++;
+        fields_bits[i] = bits;
+    }
+}
+
+uint32_t FontConverter::descrFieldSize(int bits) const
+{
+    if(bits <= 8) return 1;
+    if(bits <= 16) return 2;
+    return 4;
+}
+
+QString FontConverter::descrFieldType(int bits) const
+{
+    return QString("uint%1_t").arg(descrFieldSize(bits) * 8);
+}
+
+QString FontConverter::descrTypeName(const QString& fontName) const
+{
+    if(descr_format == DescrFull) return QString("font_char_descr_t");
+    return QString("%1_char_descr_t").arg(fontName);
+}
+
+uint32_t FontConverter::descrSize(const int* fields_bits) const
+{
+    uint32_t size = 0;
+
+    // Массивы полей без выравнивания.
+    if(descr_arrays){
+        for(int i = 0; i < descr_fields_count; i ++){
+            size += descrFieldSize(fields_bits[i]);
+        }
+        return size;
+    }
+
+    switch(descr_format){
+    default:
+    case DescrFull:
+        return char_descr_size;
+
+    case DescrNarrow:{
+        uint32_t align = 1;
+        for(int i = 0; i < descr_fields_count; i ++){
+            uint32_t field_size = descrFieldSize(fields_bits[i]);
+            size = (size + field_size - 1) / field_size * field_size + field_size;
+            if(field_size > align) align = field_size;
+        }
+        return (size + align - 1) / align * align;
+    }
+
+    case DescrBitfield:{
+        // Битовые поля не пересекают границу 32-битного слова.
+        int used_bits = 32;
+        for(int i = 0; i < descr_fields_count; i ++){
+            if(used_bits + fields_bits[i] > 32){
+                size += 4;
+                used_bits = 0;
+            }
+            used_bits += fields_bits[i];
+        }
+        return size;
+    }
+    }
+}
+
+void FontConverter::exportDescrType(QTextStream& ts, const QString& fontName, const int* fields_bits) const
+{
+    if(descr_format == DescrFull || descr_arrays) return;
+
+    ts << "\n";
+    ts << "typedef struct _" << fontName << "_char_descr {\n";
+
+    for(int i = 0; i < descr_fields_count; i ++){
+        if(descr_format == DescrBitfield){
+            ts << "    uint32_t " << descr_field_names[i] << " : " << fields_bits[i] << ";\n";
+        }else{
+            ts << "    " << descrFieldType(fields_bits[i]) << " " << descr_field_names[i] << ";\n";
+        }
+    }
+
+    ts << "} " << descrTypeName(fontName) << ";\n";
+}
+
+void FontConverter::exportDescrs(QTextStream& ts, const QString& fontName, int part_n, uint32_t first_char,
+                                 const QVector<QVector<uint32_t>>& descrs, const int* fields_bits) const
+{
+    QString countName = QString("%1_PART%2_DESCRS_COUNT").arg(fontName.toUpper()).arg(part_n);
+
+    ts << "#define " << countName << " " << descrs.size() << "\n";
+
+    if(descr_arrays){
+        for(int i = 0; i < descr_fields_count; i ++){
+            ts << "static const " << descrFieldType(fields_bits[i]) << " " << fontName << "_part" << part_n
+               << "_descrs_" << descr_field_names[i] << "[" << countName << "] = {\n";
+
+            QVector<uint32_t> values;
+            for(const QVector<uint32_t>& it: descrs){
+                values.append(it[i]);
+            }
+
+            exportValues(ts, values);
+
+            ts << "};\n";
+        }
+        return;
+    }
+
+    ts << "static const " << descrTypeName(fontName) << " " << fontName << "_part" << part_n << "_descrs"
+       << "[" << countName << "] = {\n";
+
+    uint32_t cur_char = first_char;
+
+    for(const QVector<uint32_t>& it: descrs){
+        ts << "    " << "{" << it[0] << ", " << it[1] << ", "
+           << it[2] << ", " << it[3] << ", "
+           << it[4] << ", " << it[5] << "},"
+           << " // " << cur_char << "\n";
+        cur_char ++;
+    }
+
+    ts << "};\n";
+}
+
+void FontConverter::exportMonospacePart(QTextStream& ts, const QString& fontName, int part_n, ByteLayout layout, const FontConverter::FontData& font_data) const
+{
+    QString upFontName = fontName.toUpper();
+
+    int origin_width = 0;
+    int origin_height = 0;
+
+    if(layout == ByteVertical){
+        origin_width = font_data.char_width;
+        origin_height = getFract8(font_data.char_height);
+    }else{
+        origin_width = getFract8(font_data.char_width);
+        origin_height = font_data.char_height;
+    }
+
+    uint32_t first_char = font_data.glyphs.firstKey();
+    uint32_t last_char = font_data.glyphs.lastKey();
+
+    ts << "#define " << upFontName << "_PART" << part_n << "_GRAPHICS_FORMAT "
+       << ((layout == ByteVertical) ? "GRAPHICS_FORMAT_BW_1_V" : "GRAPHICS_FORMAT_BW_1_H") << "\n";
+    ts << "#define " << upFontName << "_PART" << part_n << "_WIDTH " << origin_width << "\n";
+    ts << "#define " << upFontName << "_PART" << part_n << "_HEIGHT " << origin_height << "\n";
+    ts << "#define " << upFontName << "_PART" << part_n << "_FIRST_CHAR " << first_char << "\n";
+    ts << "#define " << upFontName << "_PART" << part_n << "_LAST_CHAR " << last_char << "\n";
+    ts << "#define " << upFontName << "_PART" << part_n << "_CHAR_WIDTH " << font_data.char_width << "\n";
+    ts << "#define " << upFontName << "_PART" << part_n << "_CHAR_HEIGHT " << font_data.char_height << "\n";
+    ts << "#define " << upFontName << "_PART" << part_n << "_CELL_BYTES "
+       << cellSize(layout, font_data.char_width, font_data.char_height) << "\n";
+
+    ts << "\n";
+
+    ts << "#define " << upFontName << "_PART" << part_n << "_DATA_SIZE "
+       << (last_char - first_char + 1) * cellSize(layout, font_data.char_width, font_data.char_height) << "\n";
+    ts << "static const uint8_t " << fontName << "_part" << part_n << "_data"
+       << "[" << upFontName << "_PART" << part_n << "_DATA_SIZE" << "] = {\n";
+
+    // Пустые ячейки для пропусков в диапазоне символов.
+    QImage empty_img(font_data.char_width, font_data.char_height, QImage::Format_MonoLSB);
+    empty_img.fill(0);
+
+    for(uint32_t char_code = first_char; char_code <= last_char; char_code ++){
+        GlyphList::const_iterator it = font_data.glyphs.constFind(char_code);
+
+        ts << "    // " << char_code << "\n";
+
+        exportBitmapData(ts, (it != font_data.glyphs.constEnd()) ? it.value().data : empty_img,
+                         origin_width, origin_height, layout);
+    }
+
+    ts << "};\n";
+}
+
+void FontConverter::exportValues(QTextStream& ts, const QVector<uint32_t>& values) const
+{
+    int line_len = 0;
+    for(uint32_t value: values){
+
+        if(line_len == 0) ts << "    ";
+
+        ts << value;
+
+        if(++ line_len < 16){
+            ts << ", ";
+        }else{
+            ts << ",\n";
+            line_len = 0;
+        }
+    }
+
+    if(line_len != 0) ts << "\n";
+}
+
+void FontConverter::getGlyphSpans(const QImage& img, QVector<QPair<int, int>>* spans) const
+{
+    for(int y = 0; y < img.height(); y ++){
+        int first_x = -1;
+        int last_x = -1;
+
+        for(int x = 0; x < img.width(); x ++){
+            if(getImagePixel(img, x, y) != 0){
+                if(first_x < 0) first_x = x;
+                last_x = x;
+            }
+        }
+
+        // Пустая строка: первый столбец больше последнего.
+        if(first_x < 0){
+            spans->append(qMakePair(1, 0));
+        }else{
+            spans->append(qMakePair(first_x, last_x));
+        }
+    }
+}
+
+void FontConverter::getSpansMax(const QList<FontConverter::FontData>& font_data_list, uint32_t* max_width, uint32_t* spans_count) const
+{
+    *max_width = 0;
+    *spans_count = 0;
+
+    // Без моноширинных пустых ячеек число строк всех частей - сумма высот глифов.
+    for(const FontData& it: font_data_list){
+        for(GlyphList::const_iterator jt = it.glyphs.constBegin(); jt != it.glyphs.constEnd(); ++ jt){
+            const QImage& img = jt.value().data;
+
+            if(static_cast<uint32_t>(img.width()) > *max_width) *max_width = img.width();
+            *spans_count += img.height();
+        }
+    }
+}
+
+uint32_t FontConverter::spanSize(uint32_t max_width) const
+{
+    // Два столбца строки: uint8_t или uint16_t.
+    return (max_width <= 256) ? 2 : 4;
+}
+
+uint32_t FontConverter::spanIndexSize(uint32_t spans_count) const
+{
+    return (spans_count < 65536) ? 2 : 4;
+}
+
+void FontConverter::exportRowSpans(QTextStream& ts, const QString& fontName, int part_n, bool monospace,
+                                   const FontConverter::FontData& font_data, uint32_t span_size, uint32_t span_index_size,
+                                   uint32_t* box_pixels, uint32_t* span_pixels) const
+{
+    QString upPartName = QString("%1_PART%2").arg(fontName.toUpper()).arg(part_n);
+    QString partName = QString("%1_part%2").arg(fontName).arg(part_n);
+
+    uint32_t first_char = font_data.glyphs.firstKey();
+    uint32_t last_char = font_data.glyphs.lastKey();
+
+    // Строки каждого символа и индекс первой строки символа.
+    QList<QVector<QPair<int, int>>> glyph_spans;
+    QVector<uint32_t> index;
+
+    uint32_t spans_count = 0;
+    uint32_t part_box_pixels = 0;
+    uint32_t part_span_pixels = 0;
+
+    for(uint32_t char_code = first_char; char_code <= last_char; char_code ++){
+        QVector<QPair<int, int>> spans;
+
+        GlyphList::const_iterator it = font_data.glyphs.constFind(char_code);
+
+        if(it != font_data.glyphs.constEnd()){
+            const QImage& img = it.value().data;
+
+            getGlyphSpans(img, &spans);
+
+            part_box_pixels += img.width() * img.height();
+        }else if(monospace){
+            // Пустая ячейка адресуется так же, как и остальные.
+            for(uint32_t y = 0; y < font_data.char_height; y ++){
+                spans.append(qMakePair(1, 0));
+            }
+        }
+
+        for(const QPair<int, int>& span: spans){
+            if(span.first <= span.second) part_span_pixels += span.second - span.first + 1;
+        }
+
+        index.append(spans_count);
+        spans_count += spans.size();
+
+        glyph_spans.append(spans);
+    }
+
+    *box_pixels += part_box_pixels;
+    *span_pixels += part_span_pixels;
+
+    ts << "\n";
+
+    ts << "// Row spans: first and last inked column of each char row, empty row has first > last.\n";
+    if(monospace){
+        ts << "// Char rows begin at " << partName << "_spans[(c - " << upPartName << "_FIRST_CHAR) * "
+           << upPartName << "_CHAR_HEIGHT].\n";
+    }else{
+        ts << "// Char rows begin at " << partName << "_spans[" << partName << "_span_index[c - "
+           << upPartName << "_FIRST_CHAR]], the index parallels the descriptors.\n";
+    }
+    ts << "// Pixel writes: " << part_box_pixels << " in boxes, " << part_span_pixels << " in spans, "
+       << (part_box_pixels - part_span_pixels) << " saved.\n";
+
+    ts << "#define " << upPartName << "_SPANS_COUNT " << spans_count << "\n";
+
+    // В части нет строк глифов, массив нулевой длины не компилируется.
+    if(spans_count == 0){
+        ts << "// No char rows, span table omitted.\n";
+        return;
+    }
+
+    ts << "static const " << ((span_size == 2) ? "uint8_t" : "uint16_t") << " " << partName << "_spans"
+       << "[" << upPartName << "_SPANS_COUNT" << "][2] = {\n";
+
+    uint32_t cur_char = first_char;
+
+    for(const QVector<QPair<int, int>>& spans: glyph_spans){
+
+        if(!spans.isEmpty()){
+            ts << "    // " << cur_char << "\n";
+
+            int line_len = 0;
+            for(const QPair<int, int>& span: spans){
+
+                if(line_len == 0) ts << "    ";
+
+                ts << "{" << span.first << ", " << span.second << "}";
+
+                if(++ line_len < 8){
+                    ts << ", ";
+                }else{
+                    ts << ",\n";
+                    line_len = 0;
+                }
+            }
+
+            if(line_len != 0) ts << "\n";
+        }
+
+        cur_char ++;
+    }
+
+    ts << "};\n";
+
+    if(monospace) return;
+
+    ts << "\n";
+
+    ts << "static const " << ((span_index_size == 2) ? "uint16_t" : "uint32_t") << " " << partName << "_span_index"
+       << "[" << upPartName << "_DESCRS_COUNT" << "] = {\n";
+
+    exportValues(ts, index);
+
+    ts << "};\n";
+}
+
+void FontConverter::exportBitmapData(QTextStream& ts, const QImage& img, int origin_width, int origin_height, ByteLayout layout) const
+{
+    int line_len = 0;
+    for(int y = 0; y < origin_height;){
+        for(int x = 0; x < origin_width;){
+
+            if(line_len == 0) ts << "    ";
+
+            ts << QString("0x%1").arg(static_cast<unsigned int>(getImageByte(img, x, y, layout)), 2, 16, QChar('0'));
+
+            if(++ line_len < 16){
+                ts << ", ";
+            }else{
+                ts << ",\n";
+                line_len = 0;
+            }
+
+            if(layout == ByteVertical){
+                x ++;
+            }else{
+                x += 8;
+            }
+        }
+        if(layout == ByteVertical){
+            y += 8;
+        }else{
+            y ++;
+        }
+    }
+
+    if(line_len != 0) ts << "\n";
+}
+
+const FontConverter::GlyphData* FontConverter::findGlyph(uint32_t char_code, const QList<FontConverter::FontData>& font_data_list) const
+{
+    for(const FontData& it: font_data_list){
+        GlyphList::const_iterator jt = it.glyphs.constFind(char_code);
+        if(jt != it.glyphs.constEnd()) return &jt.value();
+    }
+    return nullptr;
+}
+
+QImage FontConverter::composeString(const QString& text, const QList<FontConverter::FontData>& font_data_list,
+                                    QPoint* offset, int* glyphs_count) const
+{
+    // Позиции глифов в строке.
+    QList<QPair<QPoint, const GlyphData*>> glyphs;
+
+    int cur_x = 0;
+    int inked_count = 0;
+    int min_x = INT_MAX, min_y = INT_MAX;
+    int max_x = 0, max_y = 0;
+
+    for(uint32_t char_code: text.toUcs4()){
+        const GlyphData* gd = findGlyph(char_code, font_data_list);
+        if(gd == nullptr) gd = findGlyph(font_def_char, font_data_list);
+        if(gd == nullptr){
+            qDebug() << tr("Char %1 not found in font").arg(char_code);
+            continue;
+        }
+
+        QPoint pos(cur_x + gd->offset_x, gd->offset_y);
+
+        if(!gd->data.isNull()){
+            if(pos.x() < min_x) min_x = pos.x();
+            if(pos.y() < min_y) min_y = pos.y();
+            if(pos.x() + gd->data.width() > max_x) max_x = pos.x() + gd->data.width();
+            if(pos.y() + gd->data.height() > max_y) max_y = pos.y() + gd->data.height();
+        }
+
+        glyphs.append(qMakePair(pos, gd));
+
+        // Пустые глифы при рисовании не копируются.
+        if(!gd->data.isNull()) inked_count ++;
+
+        // Смещение следующего символа, как при рисовании на устройстве.
+        cur_x += gd->offset_x + gd->data.width() + font_hspace;
+    }
+
+    *glyphs_count = inked_count;
+
+    if(min_x > max_x || min_y > max_y){
+        *offset = QPoint(cur_x, 0);
+        return QImage();
+    }
+
+    QImage img(max_x - min_x, max_y - min_y, QImage::Format_MonoLSB);
+    img.fill(0);
+    QPainter painter(&img);
+
+    for(auto& it: glyphs){
+        if(it.second->data.isNull()) continue;
+        painter.drawImage(it.first.x() - min_x, it.first.y() - min_y, it.second->data);
+    }
+
+    *offset = QPoint(min_x, min_y);
+
+    return img;
+}
+
+void FontConverter::exportStaticStrings(QTextStream& ts, const QString& fontName, ByteLayout layout, const QList<FontConverter::FontData>& font_data_list) const
+{
+    QString upFontName = fontName.toUpper();
+
+    for(const StaticString& it: *staticStrings){
+
+        QPoint offset;
+        int glyphs_count = 0;
+
+        QImage img = composeString(it.text, font_data_list, &offset, &glyphs_count);
+
+        // Пустое изображение дало бы массив нулевого размера.
+        if(img.isNull()){
+            qDebug() << tr("Static string %1 has no inked pixels, skipped").arg(it.name);
+            continue;
+        }
+
+        int origin_width = 0;
+        int origin_height = 0;
+
+        if(layout == ByteVertical){
+            origin_width = img.width();
+            origin_height = getFract8(img.height());
+        }else{
+            origin_width = getFract8(img.width());
+            origin_height = img.height();
+        }
+
+        uint32_t data_size = origin_width * origin_height / 8;
+        uint32_t baked_size = data_size + char_descr_size;
+
+        QString upName = QString("%1_STR_%2").arg(upFontName).arg(it.name.toUpper());
+        QString name = QString("%1_str_%2").arg(fontName).arg(it.name);
+        QString text = it.text;
+        text.replace('\n', ' ');
+
+        // При рисовании по глифам хранится сама строка в UTF-8 с завершающим нулём.
+        uint32_t text_size = it.text.toUtf8().size() + 1;
+        int64_t size_diff = static_cast<int64_t>(baked_size) - static_cast<int64_t>(text_size);
+
+        qDebug() << tr("Static string %1: %2 inked glyphs, %3 bytes baked vs %4 bytes drawn per glyph (%5%6), %7 blits saved per draw")
+                    .arg(it.name).arg(glyphs_count).arg(baked_size).arg(text_size)
+                    .arg(size_diff >= 0 ? "+" : "").arg(size_diff)
+                    .arg(glyphs_count > 0 ? glyphs_count - 1 : 0);
+
+        ts << "\n\n";
+
+        ts << "// Static string: \"" << text << "\"\n";
+        ts << "// " << glyphs_count << " inked glyphs, " << baked_size << " bytes baked vs "
+           << text_size << " bytes of text drawn per glyph ("
+           << (size_diff >= 0 ? "+" : "") << size_diff << " bytes of flash), "
+           << glyphs_count << " blits -> 1\n";
+
+        ts << "#define " << upName << "_GRAPHICS_FORMAT "
+           << ((layout == ByteVertical) ? "GRAPHICS_FORMAT_BW_1_V" : "GRAPHICS_FORMAT_BW_1_H") << "\n";
+        ts << "#define " << upName << "_WIDTH " << origin_width << "\n";
+        ts << "#define " << upName << "_HEIGHT " << origin_height << "\n";
+
+        ts << "\n";
+
+        ts << "static const font_char_descr_t " << name << "_descr = "
+           << "{" << 0 << ", " << 0 << ", "
+           << img.width() << ", " << img.height() << ", "
+           << offset.x() << ", " << offset.y() << "};\n";
+
+        ts << "\n";
+
+        ts << "#define " << upName << "_DATA_SIZE " << data_size << "\n";
+        ts << "static const uint8_t " << name << "_data"
+           << "[" << upName << "_DATA_SIZE" << "] = {\n";
+
+        exportBitmapData(ts, img, origin_width, origin_height, layout);
+
+        ts << "};\n";
+    }
+}
+
 uint32_t FontConverter::getPow2(uint32_t n) const
 {
     return pow(2.0, ceil(log(n) / log(2.0)));
@@ -11,10 +11,15 @@
 #include <QHash>
 #include <QSize>
 #include <QPoint>
+#include <QVector>
+#include <QCache>
+#include <QPair>
+#include <QMutex>
 
 
 class QFile;
 class QXmlStreamReader;
+class QTextStream;
 
 
 class FontConverter : public QObject
@@ -27,6 +32,24 @@ public:
      */
     enum ByteLayout { ByteVertical, ByteHorizontal };
 
+    /**
+     * @brief Перечисление форматов дескрипторов символов.
+     */
+    enum DescrFormat {
+        DescrFull, //!< Стандартный font_char_descr_t.
+        DescrNarrow, //!< Поля минимального целого типа.
+        DescrBitfield //!< Битовые поля минимальной ширины.
+    };
+
+    /**
+     * @brief Перечисление режимов моноширинного шрифта.
+     */
+    enum MonospaceMode {
+        MonospaceOff, //!< Глифы обрезаются, дескрипторы экспортируются.
+        MonospaceAuto, //!< Моноширинный, если все глифы, включая пустые, сдвигают на одинаковую ширину.
+        MonospaceForced //!< Моноширинный, ячейки разного размера, обрезка и стирание глифов - ошибка.
+    };
+
     explicit FontConverter(QObject *parent = 0);
     ~FontConverter();
 
@@ -36,8 +59,65 @@ public:
      */
     void setByteLayout(ByteLayout layout);
 
+    /**
+     * @brief Включает оптимизацию разбиения символов на части.
+     * @param optimize Флаг оптимизации.
+     */
+    void setOptimizeLayout(bool optimize);
+
+    /**
+     * @brief Устанавливает формат дескрипторов символов.
+     * Ширина полей выбирается по диапазону значений шрифта.
+     * @param format Формат дескрипторов.
+     */
+    void setDescrFormat(DescrFormat format);
+
+    /**
+     * @brief Включает экспорт дескрипторов отдельными массивами полей.
+     * Поля имеют минимальный целый тип.
+     * @param arrays Флаг экспорта массивами.
+     */
+    void setDescrArrays(bool arrays);
+
+    /**
+     * @brief Устанавливает режим моноширинного шрифта.
+     * Глифы моноширинного шрифта не обрезаются
+     * и адресуются без дескрипторов по коду символа.
+     * @param mode Режим моноширинного шрифта.
+     */
+    void setMonospaceMode(MonospaceMode mode);
+
+    /**
+     * @brief Включает экспорт строк глифов.
+     * Для каждой строки глифа экспортируются
+     * первый и последний закрашенные столбцы.
+     * @param spans Флаг экспорта строк.
+     */
+    void setRowSpans(bool spans);
+
+    /**
+     * @brief Устанавливает горизонтальный интервал между символами.
+     * Экспортируется в _DEF_HSPACE и используется при сборке статических строк.
+     * @param hspace Интервал в пикселях.
+     */
+    void setFontHSpace(uint32_t hspace);
+
+    /**
+     * @brief Включает кэширование прочитанных шрифтов.
+     * Повторное преобразование тех же входных файлов
+     * не требует их повторного чтения.
+     * @param caching Флаг кэширования.
+     */
+    void setFontCaching(bool caching);
+
+    /**
+     * @brief Очищает кэш прочитанных шрифтов.
+     */
+    void clearFontCache();
+
     /**
      * @brief Очищает все добавленные данные.
+     * Кэш прочитанных шрифтов сохраняется.
      */
     void clear();
 
@@ -49,6 +129,28 @@ public:
      */
     void addFontInterval(const QString& fileName, uint32_t firstChar, uint32_t lastChar);
 
+    /**
+     * @brief Добавляет выходной файл для преобразования.
+     * @param fileName Имя выходного файла.
+     * @param fontName Имя шрифта.
+     * @param layout Расположение байта.
+     * @param firstChar Начальный символ.
+     * @param lastChar Конечный символ.
+     */
+    void addOutput(const QString& fileName, const QString& fontName, ByteLayout layout,
+                   uint32_t firstChar = 0, uint32_t lastChar = UINT32_MAX);
+
+    /**
+     * @brief Добавляет статическую строку.
+     * Строка собирается из глифов шрифта
+     * и экспортируется готовым изображением.
+     * @param name Имя строки, допустимый идентификатор C,
+     * не совпадающий с другими без учёта регистра.
+     * @param text Текст строки.
+     * @return Флаг успеха.
+     */
+    bool addStaticString(const QString& name, const QString& text);
+
     /**
      * @brief Добавляет переопределение размера символа.
      * @param char_code Код символа.
@@ -57,6 +159,12 @@ public:
      */
     void addGlyphSizeOverride(uint32_t char_code, const QPoint& pos, const QSize& size);
 
+    /**
+     * @brief Получает сообщение о первой ошибке последнего преобразования.
+     * @return Сообщение об ошибке.
+     */
+    QString errorString() const;
+
     /**
      * @brief Преобразует шрифт.
      * @param fileName Имя выходного файла.
@@ -65,6 +173,14 @@ public:
      */
     bool convert(const QString& fileName, const QString& fontName) const;
 
+    /**
+     * @brief Преобразует шрифт во все добавленные выходные файлы.
+     * Входные файлы читаются один раз,
+     * выходные файлы формируются параллельно и не должны повторяться.
+     * @return Флаг успеха.
+     */
+    bool convert() const;
+
 signals:
 
 public slots:
@@ -114,6 +230,61 @@ private:
     //! Входные данные.
     QList<FontInput>* inputs;
 
+    /**
+     * @brief Структура выходных данных преобразования.
+     */
+    struct FontOutput{
+
+        FontOutput(){
+            fileOut = QString();
+            fontName = QString();
+            byteLayout = ByteVertical;
+            firstChar = 0;
+            lastChar = 0;
+        }
+
+        FontOutput(const QString& file_out, const QString& font_name, ByteLayout layout, uint32_t first_char, uint32_t last_char){
+            fileOut = file_out;
+            fontName = font_name;
+            byteLayout = layout;
+            firstChar = first_char;
+            lastChar = last_char;
+        }
+
+        FontOutput(const FontOutput& fo){
+            fileOut = fo.fileOut;
+            fontName = fo.fontName;
+            byteLayout = fo.byteLayout;
+            firstChar = fo.firstChar;
+            lastChar = fo.lastChar;
+        }
+
+        ~FontOutput(){}
+
+        FontOutput& operator=(const FontOutput& fo){
+            fileOut = fo.fileOut;
+            fontName = fo.fontName;
+            byteLayout = fo.byteLayout;
+            firstChar = fo.firstChar;
+            lastChar = fo.lastChar;
+            return *this;
+        }
+
+        //! Имя выходного файла.
+        QString fileOut;
+        //! Имя шрифта.
+        QString fontName;
+        //! Расположение байт.
+        ByteLayout byteLayout;
+        //! Начальный символ.
+        uint32_t firstChar;
+        //! Конечный символ.
+        uint32_t lastChar;
+    };
+
+    //! Выходные данные.
+    QList<FontOutput>* outputs;
+
     /**
      * @brief Структура данных глифа шрифта.
      */
@@ -163,6 +334,8 @@ private:
     struct FontData {
 
         FontData(){
+            char_from = 0;
+            char_to = 0;
             char_width = 0;
             char_height = 0;
             bitmap_width = 0;
@@ -171,6 +344,8 @@ private:
         }
 
         FontData(const FontData& fd){
+            char_from = fd.char_from;
+            char_to = fd.char_to;
             char_width = fd.char_width;
             char_height = fd.char_height;
             bitmap_width = fd.bitmap_width;
@@ -181,6 +356,8 @@ private:
         ~FontData() {}
 
         FontData& operator=(const FontData& fd){
+            char_from = fd.char_from;
+            char_to = fd.char_to;
             char_width = fd.char_width;
             char_height = fd.char_height;
             bitmap_width = fd.bitmap_width;
@@ -239,17 +416,153 @@ private:
         QSize size;
     };
 
+    /**
+     * @brief Структура статической строки.
+     */
+    struct StaticString {
+
+        StaticString(){
+            name = QString();
+            text = QString();
+        }
+
+        StaticString(const QString& n, const QString& t){
+            name = n;
+            text = t;
+        }
+
+        StaticString(const StaticString& ss){
+            name = ss.name;
+            text = ss.text;
+        }
+
+        ~StaticString(){}
+
+        StaticString& operator=(const StaticString& ss){
+            name = ss.name;
+            text = ss.text;
+            return *this;
+        }
+
+        //! Имя строки.
+        QString name;
+        //! Текст строки.
+        QString text;
+    };
+
+    //! Статические строки.
+    QList<StaticString>* staticStrings;
+
     //! Словарь переопределённых размеров символов.
     QHash<uint32_t, GlyphSizeOverride>* glyphOverrides;
 
     //! Расположение байт.
     ByteLayout byte_layout;
 
+    //! Флаг оптимизации разбиения на части.
+    bool optimize_layout;
+
+    //! Формат дескрипторов символов.
+    DescrFormat descr_format;
+    //! Флаг экспорта дескрипторов массивами полей.
+    bool descr_arrays;
+
+    //! Режим моноширинного шрифта.
+    MonospaceMode monospace_mode;
+
+    //! Флаг экспорта строк глифов.
+    bool row_spans;
+
+    //! Горизонтальный интервал между символами шрифта.
+    uint32_t font_hspace;
+
+    //! Сообщение о первой ошибке преобразования.
+    mutable QString error_string;
+    //! Мьютекс сообщения об ошибке, выходы преобразуются параллельно.
+    mutable QMutex error_mutex;
+
+    /**
+     * @brief Прочитанные и обработанные шрифты в кэше.
+     */
+    struct FontCache {
+
+        FontCache(const QList<FontData>& f, bool mono){
+            fonts = f;
+            monospace = mono;
+        }
+
+        ~FontCache(){}
+
+        //! Данные шрифтов.
+        QList<FontData> fonts;
+        //! Флаг моноширинного шрифта.
+        bool monospace;
+    };
+
+    //! Флаг кэширования шрифтов.
+    bool font_caching;
+    //! Кэш шрифтов.
+    QCache<QString, FontCache>* fontCache;
+    //! Максимальное количество шрифтов в кэше.
+    static const int font_cache_size = 16;
+
+    //! Количество полей дескриптора символа.
+    static const int descr_fields_count = 6;
+
+    //! Размер дескриптора символа font_char_descr_t на целевой платформе.
+    static const uint32_t char_descr_size = 12;
+    //! Размер записи font_bitmap_t на целевой платформе.
+    static const uint32_t font_bitmap_size = 24;
+
+    //! Символ по умолчанию.
+    static const uint32_t font_def_char = 127;
+
+    void setError(const QString& error) const;
+    bool loadFonts(QList<FontData>* font_data_list, bool* monospace) const;
+    QString fontCacheKey() const;
+    bool convertOutput(const FontOutput& fout, const QList<FontData>& font_data_list, bool monospace) const;
     bool convertInterval(const FontInput& fin, QList<FontData>* font_data_list) const;
     bool convertFont(QXmlStreamReader* xmlreader, const FontConverter::FontInput& fin, FontData* font_data) const;
     QImage pixelsStrToImage(const QString& pixelsStr, uint32_t width, uint32_t height) const;
 
-    bool exportFont(QFile& outFile, const QString& fontName, QList<FontData>* font_data_list) const;
+    void trimFont(QList<FontData>* font_data_list) const;
+    bool checkMonospace(const QList<FontData>& font_data_list, bool* monospace, QSize* cell_size) const;
+    int getGlyphInkRight(const QImage& img) const;
+    void cellFont(QList<FontData>* font_data_list, const QSize& cell_size) const;
+    void updateBitmapSize(FontData& font_data) const;
+    void optimizeLayout(QList<FontData>* font_data_list, ByteLayout layout, bool monospace) const;
+    uint32_t layoutDescrSize(const QList<FontData>& font_data_list, bool monospace) const;
+    uint32_t partSize(ByteLayout layout, uint32_t descr_size, uint32_t first_char, uint32_t last_char, uint32_t bitmap_width, uint32_t bitmap_height) const;
+    uint32_t monospacePartSize(ByteLayout layout, uint32_t first_char, uint32_t last_char, uint32_t char_width, uint32_t char_height) const;
+    uint32_t cellSize(ByteLayout layout, uint32_t char_width, uint32_t char_height) const;
+    uint32_t fontPartSize(const FontData& font_data, ByteLayout layout, uint32_t descr_size, bool monospace) const;
+    uint32_t layoutSize(const QList<FontData>& font_data_list, ByteLayout layout, uint32_t descr_size, bool monospace) const;
+    void printLayout(const QString& title, const QList<FontData>& font_data_list, ByteLayout layout, uint32_t descr_size, bool monospace) const;
+
+    void getDescrFieldsMax(const QList<FontData>& font_data_list, uint32_t* fields_max) const;
+    void getDescrFieldsBits(const uint32_t* fields_max, int* fields_bits) const;
+    uint32_t descrFieldSize(int bits) const;
+    QString descrFieldType(int bits) const;
+    QString descrTypeName(const QString& fontName) const;
+    uint32_t descrSize(const int* fields_bits) const;
+    void exportDescrType(QTextStream& ts, const QString& fontName, const int* fields_bits) const;
+    void exportDescrs(QTextStream& ts, const QString& fontName, int part_n, uint32_t first_char,
+                      const QVector<QVector<uint32_t>>& descrs, const int* fields_bits) const;
+
+    bool exportFont(QFile& outFile, const QString& fontName, ByteLayout layout, bool monospace, QList<FontData>* font_data_list) const;
+    void exportMonospacePart(QTextStream& ts, const QString& fontName, int part_n, ByteLayout layout, const FontData& font_data) const;
+    void exportValues(QTextStream& ts, const QVector<uint32_t>& values) const;
+    void getGlyphSpans(const QImage& img, QVector<QPair<int, int>>* spans) const;
+    void getSpansMax(const QList<FontData>& font_data_list, uint32_t* max_width, uint32_t* spans_count) const;
+    uint32_t spanSize(uint32_t max_width) const;
+    uint32_t spanIndexSize(uint32_t spans_count) const;
+    void exportRowSpans(QTextStream& ts, const QString& fontName, int part_n, bool monospace,
+                        const FontData& font_data, uint32_t span_size, uint32_t span_index_size,
+                        uint32_t* box_pixels, uint32_t* span_pixels) const;
+    void exportBitmapData(QTextStream& ts, const QImage& img, int origin_width, int origin_height, ByteLayout layout) const;
+    const GlyphData* findGlyph(uint32_t char_code, const QList<FontData>& font_data_list) const;
+    QImage composeString(const QString& text, const QList<FontData>& font_data_list, QPoint* offset, int* glyphs_count) const;
+    void exportStaticStrings(QTextStream& ts, const QString& fontName, ByteLayout layout, const QList<FontData>& font_data_list) const;
     uint32_t getPow2(uint32_t n) const;
     uint32_t getFract8(uint32_t n) const;
     uint8_t getImagePixel(const QImage& img, int x, int y) const;
@@ -1,9 +1,68 @@
 #include "mainwindow.h"
+#include "conversionserver.h"
 #include <QApplication>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QDebug>
+#include <string.h>
 
 
+/**
+ * @brief Выполняет преобразование без графического интерфейса.
+ * @return Код завершения.
+ */
+static int runConsole(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption("server", "Accept conversion jobs on local socket <name>.", "name"));
+    parser.addOption(QCommandLineOption("stdio", "Accept conversion jobs on stdin, reply on stdout."));
+    parser.addOption(QCommandLineOption("client", "Send conversion job to server <name>.", "name"));
+    parser.addPositionalArgument("job", "Job file for client, stdin if omitted.");
+    parser.process(a);
+
+    if(parser.isSet("client")){
+        QFile file;
+
+        if(parser.positionalArguments().isEmpty()){
+            if(!file.open(stdin, QIODevice::ReadOnly)) return 1;
+        }else{
+            file.setFileName(parser.positionalArguments().first());
+            if(!file.open(QIODevice::ReadOnly)){
+                qDebug() << QString("Error open job file: %1").arg(file.fileName());
+                return 1;
+            }
+        }
+
+        return ConversionServer::runClient(parser.value("client"), file.readAll());
+    }
+
+    ConversionServer server;
+
+    if(parser.isSet("stdio")){
+        return server.runStdio();
+    }
+
+    if(parser.isSet("server")){
+        if(!server.listen(parser.value("server"))) return 1;
+        return a.exec();
+    }
+
+    parser.showHelp(1);
+
+    return 1;
+}
+
 int main(int argc, char *argv[])
 {
+    // Режимы сервера и клиента не требуют графического интерфейса.
+    if(argc > 1 && strncmp(argv[1], "--", 2) == 0){
+        return runConsole(argc, argv);
+    }
+
     QApplication a(argc, argv);
 
     MainWindow w;